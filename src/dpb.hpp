@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace dpb {
+
+enum class WireType : uint8_t {
+    VARINT = 0,
+    I64 = 1,
+    LEN = 2,
+    I32 = 5,
+};
+
+/// Field descriptor for compile-time reflection
+template <typename C, typename T>
+struct Field {
+    int number;
+    WireType wireType;
+    const char *name;
+    T C::*member;
+    int capacity;
+};
+
+/// Field descriptors of a message, specialized by the generated code outside of the message class so that the names
+/// can't collide with fields
+template <typename C>
+struct Reflection;
+
+/// Get the field descriptors of a message as tuple of Field
+template <typename C>
+constexpr auto fields() {
+    return Reflection<C>::fields();
+}
+
+/// Index of a field that is passed to visitors, the descriptor is available at compile time as field
+template <typename C, size_t I>
+struct FieldIndex : std::integral_constant<size_t, I> {
+    static constexpr auto field = std::get<I>(Reflection<C>::fields());
+};
+
+template <typename C, size_t I>
+inline constexpr FieldIndex<C, I> fieldIndex{};
+
+template <typename C, typename F, size_t... I>
+void visitFields(C &message, F &f, std::index_sequence<I...>) {
+    using M = std::remove_const_t<C>;
+    (f(fieldIndex<M, I>, message.*(FieldIndex<M, I>::field.member)), ...);
+}
+
+/// Call f(index, value) for each field of a message where index.field is the descriptor as compile-time constant
+template <typename C, typename F>
+void visit(C &message, F &&f) {
+    using M = std::remove_const_t<C>;
+    visitFields(message, f, std::make_index_sequence<std::tuple_size_v<decltype(Reflection<M>::fields())>>());
+}
+
+} // namespace dpb
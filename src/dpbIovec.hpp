@@ -0,0 +1,20 @@
+#pragma once
+
+#include "dpbSegments.hpp"
+#include <sys/uio.h>
+
+
+namespace dpb {
+
+static_assert(sizeof(Segment) == sizeof(iovec)
+    && offsetof(Segment, data) == offsetof(iovec, iov_base)
+    && offsetof(Segment, size) == offsetof(iovec, iov_len));
+
+/// Get the segments of a list as iovec array for writev() or sendmsg(). The cast removes const from Segment::data as
+/// iovec::iov_base is void *, the functions only read from it
+template <int N>
+iovec *iovecs(SegmentList<N> &list) {
+    return reinterpret_cast<iovec *>(list.segments);
+}
+
+} // namespace dpb
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace dpb {
+
+/// Segment of a scatter-gather list, same layout as struct iovec (see dpbIovec.hpp)
+struct Segment {
+    const void *data;
+    size_t size;
+};
+
+/// Scatter-gather list for write(w, segments): Tags and small values are written to the staging buffer of the writer,
+/// string/bytes values of at least threshold bytes are referenced in place. Call segments.flush(w) after one or more
+/// writes and segments.reset(w) before reusing the list for a new buffer.
+template <int N>
+struct SegmentList {
+    static_assert(N >= 3);
+
+    Segment segments[N];
+    int count = 0;
+    int threshold;
+    const uint8_t *mark;
+
+    template <typename W>
+    SegmentList(W &w, int minSize = 256) : threshold(minSize), mark(w) {}
+
+    template <typename W>
+    void reset(W &w) {
+        this->count = 0;
+        this->mark = w;
+    }
+
+    template <typename W, typename V>
+    void data(W &w, const V &value) {
+        int size = value.size();
+
+        // copy small values and fall back to copying when running out of segments
+        if (size < this->threshold || this->count + 3 > N) {
+            w.data(value);
+            return;
+        }
+        flush(w);
+        this->segments[this->count++] = {value.data(), size_t(size)};
+    }
+
+    template <typename W>
+    void flush(W &w) {
+        const uint8_t *current = w;
+        if (current > this->mark) {
+            // extend the last segment if the staged data follows it, otherwise there is at least one free segment
+            Segment *last = this->count > 0 ? &this->segments[this->count - 1] : nullptr;
+            if (last != nullptr && (const uint8_t *)last->data + last->size == this->mark)
+                last->size += current - this->mark;
+            else
+                this->segments[this->count++] = {this->mark, size_t(current - this->mark)};
+        }
+        this->mark = current;
+    }
+};
+
+} // namespace dpb